@@ -1,6 +1,21 @@
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include <new>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>		// a zajszuro belso ciklusahoz
+#endif
+
+#if !defined(GRAFTEST_HEADLESS)		// a fejnelkuli mod OpenGL es GLUT nelkul fordul
 #if defined(__APPLE__)
 #include <OpenGL/gl.h>
 #include <OpenGL/glu.h>
@@ -13,17 +28,186 @@
 #include <GL/glu.h>
 #include <GL/glut.h>
 #endif
+#endif
+
+#if defined(GRAFTEST_HEADLESS) && !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__)
+#include <sys/resource.h>		// PeakMemoryKB()
+#endif
 
-#define RND (2.0*(double)rand()/RAND_MAX-1.0)
+#define RND (2.0*Random01()-1.0)
 #define PI 3.14159265f
 #define depth_Max 5
 #define epsilon 1e-3f
 #define photonConst 3.0f
+#define shadowRayBudget 4
+#define previewStep 4		// mozgatas kozben previewStep x previewStep pixelenkent egy sugar
+#define previewDepth 1		// mozgatas kozben ennyi visszaverodest/torest kovetunk
+#define refineDelayMs 150	// ennyi nyugalmi ido utan indul a teljes minosegu kep
+#define denoisePasses 5		// a-trous szuro lepesei (1, 2, 4, 8, 16 pixeles lyukak)
+
+// 1: a csucsfenyhez a gyors (1 - (1-x)*n/16)^16 kozelitest hasznaljuk,
+//    abszolut hibaja 16 feletti shininess-nel 0.02 alatt marad
+// 0: egesz kitevore pontos, negyzetre emeleses hatvanyozas
+#ifndef FAST_SPECULAR
+#define FAST_SPECULAR 0
+#endif
+
+// Szalankenti veletlenszam-generator (xorshift32): a rand() nem szalbiztos, az InteractiveView
+// szalai pedig egyszerre mintavetelezik a fenyeket. Minden szal kulon magot kap.
+std::atomic<unsigned int> nextRandomSeed(1);
+thread_local unsigned int randomState = nextRandomSeed++ * 2654435761u;
+
+void SeedRandom(unsigned int seed)
+{
+	randomState = seed * 2654435761u;
+	if (randomState == 0)
+	{
+		randomState = 1;
+	}
+}
+
+// Egyenletes eloszlas [0, 1)-en, 24 bites felbontassal
+float Random01()
+{
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 17;
+	randomState ^= randomState << 5;
+	return (randomState >> 8) * (1.0f / 16777216.0f);
+}
 
 
 const int screenWidth = 600;
 const int screenHeight = 600;
 
+// Novekvo tomb vegere fuz, szukseg eseten duplazza a kapacitast
+template<class T>
+void Append(T*& items, int& count, int& capacity, T item)
+{
+	if (count == capacity)
+	{
+		capacity = capacity == 0 ? 4 : capacity * 2;
+		T* grown = new T[capacity];
+		for (int i = 0; i < count; i++)
+		{
+			grown[i] = items[i];
+		}
+		delete[] items;
+		items = grown;
+	}
+	items[count++] = item;
+}
+
+//--------------------------------------------------------
+// Jelenet-arena: a primitivek, csoportok, listak es gyorsito
+// strukturak nagy blokkokban, egymas utan foglalodnak, es egyetlen
+// Reset()-tel szabadulnak fel. Destruktor nem fut, ezert csak olyan
+// tipus kerulhet ide, amely nem birtokol arenan kivuli memoriat.
+//--------------------------------------------------------
+class SceneArena
+{
+	struct Block
+	{
+		Block* next;
+		size_t size;
+		size_t used;
+	};
+
+	static const size_t blockSize = 1 << 20;
+	static const size_t alignment = 16;
+
+	Block* first;
+	Block* last;
+	Block* current;
+
+	static size_t Align(size_t bytes)
+	{
+		return (bytes + alignment - 1) & ~(size_t)(alignment - 1);
+	}
+
+public:
+	SceneArena()
+	{
+		first = last = current = 0;
+	}
+
+	~SceneArena()
+	{
+		while (first)
+		{
+			Block* next = first->next;
+			free(first);
+			first = next;
+		}
+	}
+
+	void* Allocate(size_t bytes)
+	{
+		bytes = Align(bytes);
+		while (current && current->used + bytes > current->size)
+		{
+			current = current->next;
+		}
+
+		if (current == 0)
+		{
+			size_t size = bytes > blockSize ? bytes : blockSize;
+			Block* block = (Block*)malloc(Align(sizeof(Block)) + size);
+			if (block == 0)
+			{
+				throw std::bad_alloc();		// mint a sima new
+			}
+			block->next = 0;
+			block->size = size;
+			block->used = 0;
+			if (last)
+			{
+				last->next = block;
+			}
+			else
+			{
+				first = block;
+			}
+			last = current = block;
+		}
+
+		void* memory = (char*)current + Align(sizeof(Block)) + current->used;
+		current->used += bytes;
+		return memory;
+	}
+
+	// Minden foglalas egyszerre ervenytelen; a blokkok megmaradnak a kovetkezo jelenetnek
+	void Reset()
+	{
+		for (Block* block = first; block; block = block->next)
+		{
+			block->used = 0;
+		}
+		current = first;
+	}
+};
+
+void* operator new(size_t size, SceneArena& arena) { return arena.Allocate(size); }
+void* operator new[](size_t size, SceneArena& arena) { return arena.Allocate(size); }
+void operator delete(void*, SceneArena&) {}
+void operator delete[](void*, SceneArena&) {}
+
+// Mint az Append, de az arenabol novel; a regi tomb a Reset()-ig ott marad
+template<class T>
+void Append(T*& items, int& count, int& capacity, T item, SceneArena& arena)
+{
+	if (count == capacity)
+	{
+		capacity = capacity == 0 ? 4 : capacity * 2;
+		T* grown = new (arena) T[capacity];
+		for (int i = 0; i < count; i++)
+		{
+			grown[i] = items[i];
+		}
+		items = grown;
+	}
+	items[count++] = item;
+}
+
 
 
 //--------------------------------------------------------
@@ -69,6 +253,149 @@ struct Vector {
 
 Vector UpVector = Vector(0.0f, 1.0f, 0.0f);
 
+float VectorComponent(Vector v, int axis)
+{
+	return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+//--------------------------------------------------------
+// Tengelyekkel parhuzamos befoglalo doboz
+//--------------------------------------------------------
+struct AABB {
+	Vector lo, hi;
+
+	AABB() {
+		lo = Vector(1e30f, 1e30f, 1e30f);
+		hi = Vector(-1e30f, -1e30f, -1e30f);
+	}
+
+	void Extend(Vector p) {
+		if (p.x < lo.x) lo.x = p.x;
+		if (p.y < lo.y) lo.y = p.y;
+		if (p.z < lo.z) lo.z = p.z;
+		if (p.x > hi.x) hi.x = p.x;
+		if (p.y > hi.y) hi.y = p.y;
+		if (p.z > hi.z) hi.z = p.z;
+	}
+	void Extend(AABB box) {
+		Extend(box.lo);
+		Extend(box.hi);
+	}
+	// Minden iranyban amount-tal bovit (a feluleten veget ero sugarak lebeghetnek a doboz hataran)
+	void Grow(float amount) {
+		lo = lo - Vector(amount, amount, amount);
+		hi = hi + Vector(amount, amount, amount);
+	}
+	Vector Center() { return (lo + hi) * 0.5f; }
+	Vector Size() { return hi - lo; }
+	int LongestAxis() {
+		Vector size = Size();
+		if (size.x > size.y && size.x > size.z) return 0;
+		return size.y > size.z ? 1 : 2;
+	}
+
+	// Sugar-doboz metszes (slab), a [0, tMax] szakaszra; tEntry a belepesi parameter
+	bool Hit(Vector origin, Vector invDir, float tMax, float& tEntry) {
+		float t0 = 0.0f, t1 = tMax;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float o = VectorComponent(origin, axis);
+			float inv = VectorComponent(invDir, axis);
+			float tNear = (VectorComponent(lo, axis) - o) * inv;
+			float tFar = (VectorComponent(hi, axis) - o) * inv;
+			if (tNear > tFar) { float tmp = tNear; tNear = tFar; tFar = tmp; }
+			if (tNear > t0) t0 = tNear;
+			if (tFar < t1) t1 = tFar;
+			if (t0 > t1) return false;
+		}
+		tEntry = t0;
+		return true;
+	}
+};
+
+//--------------------------------------------------------
+// Affin transzformacio: p' = M * p + T
+//--------------------------------------------------------
+struct Transform {
+	float m[3][3];
+	Vector T;
+
+	Transform() {
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 3; j++)
+				m[i][j] = (i == j) ? 1.0f : 0.0f;
+	}
+
+	static Transform Translation(Vector offset) {
+		Transform tr;
+		tr.T = offset;
+		return tr;
+	}
+	static Transform RotationY(float angle) {
+		Transform tr;
+		tr.m[0][0] = cos(angle);  tr.m[0][2] = sin(angle);
+		tr.m[2][0] = -sin(angle); tr.m[2][2] = cos(angle);
+		return tr;
+	}
+	static Transform Scale(float s) {
+		Transform tr;
+		tr.m[0][0] = tr.m[1][1] = tr.m[2][2] = s;
+		return tr;
+	}
+
+	Vector Direction(Vector d) {
+		return Vector(m[0][0] * d.x + m[0][1] * d.y + m[0][2] * d.z,
+		              m[1][0] * d.x + m[1][1] * d.y + m[1][2] * d.z,
+		              m[2][0] * d.x + m[2][1] * d.y + m[2][2] * d.z);
+	}
+	Vector TransposedDirection(Vector d) {	// normalvektorokhoz, az inverz transzformaciobol hivva
+		return Vector(m[0][0] * d.x + m[1][0] * d.y + m[2][0] * d.z,
+		              m[0][1] * d.x + m[1][1] * d.y + m[2][1] * d.z,
+		              m[0][2] * d.x + m[1][2] * d.y + m[2][2] * d.z);
+	}
+	Vector Point(Vector p) {
+		return Direction(p) + T;
+	}
+
+	Transform operator*(Transform other) {	// eloszor other, utana this
+		Transform tr;
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 3; j++)
+				tr.m[i][j] = m[i][0] * other.m[0][j] + m[i][1] * other.m[1][j] + m[i][2] * other.m[2][j];
+		tr.T = Point(other.T);
+		return tr;
+	}
+
+	Transform Inverse() {
+		Transform inv;
+		float det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+		          - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+		          + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+		inv.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) / det;
+		inv.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) / det;
+		inv.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) / det;
+		inv.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) / det;
+		inv.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) / det;
+		inv.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) / det;
+		inv.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) / det;
+		inv.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) / det;
+		inv.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) / det;
+		inv.T = inv.Direction(T) * -1.0f;
+		return inv;
+	}
+
+	AABB Apply(AABB box) {
+		AABB result;
+		for (int corner = 0; corner < 8; corner++)
+		{
+			result.Extend(Point(Vector((corner & 1) ? box.hi.x : box.lo.x,
+			                           (corner & 2) ? box.hi.y : box.lo.y,
+			                           (corner & 4) ? box.hi.z : box.lo.z)));
+		}
+		return result;
+	}
+};
+
 //--------------------------------------------------------
 // Spektrum illetve szin
 //--------------------------------------------------------
@@ -110,12 +437,101 @@ struct Color {
 };
 
 float image[screenWidth*screenHeight * 3];
+float hdrImage[screenWidth*screenHeight * 3];	// tonuslekepezes elotti sugarsuruseg
+float denoisedImage[screenWidth*screenHeight * 3];	// hdrImage zajszurve
 
 struct Ray
 {
 	Vector rOrigo, rDirection;
 };
 
+//--------------------------------------------------------
+// Egy pixel kovetesekor kilott sugarszakaszok (elsodleges, tukrozott,
+// tort es arnyeksugarak), az inkrementalis ujrarajzolashoz
+//--------------------------------------------------------
+struct RaySegment
+{
+	Ray ray;
+	float tMax;
+};
+
+struct SegmentBuffer
+{
+	RaySegment* segments;
+	int count;
+	int capacity;
+
+	SegmentBuffer()
+	{
+		segments = 0;
+		count = 0;
+		capacity = 0;
+	}
+
+	void Add(Ray ray, float tMax)
+	{
+		RaySegment segment;
+		segment.ray = ray;
+		segment.tMax = tMax;
+		Append(segments, count, capacity, segment);
+	}
+};
+
+// x^n egesz n-re, negyzetre emelessel (pow() hivas nelkul)
+float PowInt(float x, int n)
+{
+	float result = 1.0f;
+	while (n > 0)
+	{
+		if (n & 1)
+		{
+			result *= x;
+		}
+		x *= x;
+		n >>= 1;
+	}
+	return result;
+}
+
+// Schlick-fele Fresnel tag: (1 - cosa)^5, szorzasokkal
+float FresnelTerm(float cosa)
+{
+	float m = 1.0f - cosa;
+	float m2 = m * m;
+	return m2 * m2 * m;
+}
+
+// cosdelta^shininess a Phong-Blinn csucsfenyhez
+float SpecularPower(float cosdelta, float shininess)
+{
+#if FAST_SPECULAR
+	if (shininess >= 16.0f)
+	{
+		float base = 1.0f - (1.0f - cosdelta) * shininess / 16.0f;
+		if (base < 0.0f)
+		{
+			return 0.0f;
+		}
+		return PowInt(base, 16);
+	}
+#endif
+	int n = int(shininess);
+	if (float(n) == shininess)
+	{
+		return PowInt(cosdelta, n);
+	}
+	return pow(cosdelta, shininess);
+}
+
+// Anyagosztalyok, mindegyikhez kulon forditott arnyalo kernel tartozik (World::Shade)
+enum MaterialClass
+{
+	MAT_GENERIC,			// barmilyen jelzo-kombinacio, futasideju elagazasokkal
+	MAT_DIFFUSE_PATTERN,	// diffuz, mintazott (sakktabla) felulet
+	MAT_CONDUCTOR,			// csak tukrozo fem (arany, ezust)
+	MAT_DIELECTRIC			// csak tores (uveg)
+};
+
 struct ObjMat
 {
 	Color F0;
@@ -129,6 +545,8 @@ struct ObjMat
 
 	bool flat;
 
+	MaterialClass kind;
+
 	ObjMat()
 	{
 		IsReflective = false;
@@ -137,6 +555,31 @@ struct ObjMat
 		shininess = 0.0f;
 
 		flat = false;
+		kind = MAT_GENERIC;
+	}
+
+	// A jelzokbol kiszamolja az anyagosztalyt. A fem es az uveg kernel nem kovet arnyeksugarat,
+	// ezert csak akkor valaszthato, ha az anyagnak nincs diffuz es csucsfeny tagja.
+	void Classify()
+	{
+		bool dark = !(kd_DiffuseColor != Color(0.0f, 0.0f, 0.0f)) && !(ks_SpecularColor != Color(0.0f, 0.0f, 0.0f));
+
+		if (!IsReflective && !IsRefractive && kd_DiffuseColor != Color(0.0f, 0.0f, 0.0f))
+		{
+			kind = MAT_DIFFUSE_PATTERN;
+		}
+		else if (IsReflective && !IsRefractive && dark)
+		{
+			kind = MAT_CONDUCTOR;
+		}
+		else if (IsRefractive && !IsReflective && dark)
+		{
+			kind = MAT_DIELECTRIC;
+		}
+		else
+		{
+			kind = MAT_GENERIC;
+		}
 	}
 
 	void DirOfReflection(Vector& Reflected, Vector SurfaceNormal, Vector Incoming)
@@ -172,7 +615,7 @@ struct ObjMat
 	Color CalculateFresnel(Vector SurfaceNormal, Vector Incoming)
 	{
 		float cosa = fabs(SurfaceNormal * Incoming);
-		return F0 + (Color(1.0f, 1.0f, 1.0f) - F0) * pow(1 - cosa, 5);
+		return F0 + (Color(1.0f, 1.0f, 1.0f) - F0) * FresnelTerm(cosa);
 	}
 
 	Color ReflectionRadiance(Vector L, Vector SurfaceNormal, Vector Incoming, Color LinearLight)
@@ -194,7 +637,7 @@ struct ObjMat
 			return ReflectedColor;
 		}
 
-		ReflectedColor = ReflectedColor + LinearLight * ks_SpecularColor * pow(cosdelta, shininess);
+		ReflectedColor = ReflectedColor + LinearLight * ks_SpecularColor * SpecularPower(cosdelta, shininess);
 
 		return ReflectedColor;
 	}
@@ -219,17 +662,35 @@ struct Collide
 	}
 };
 
+// A feluleti anyagot csak a primitivek taroljak; a Group es az Instance a gyerekeiktol kapja
 class Object
 {
-protected:
-	ObjMat Material;
 public:
 	virtual Collide Intersect(Ray ray) = 0;
 
+	// Befoglalo doboz; false, ha az objektum nem korlatos (ilyenkor minden sugarat tesztelni kell)
+	virtual bool Bounds(AABB& box) { return false; }
+
+	// Uj elhelyezes; false, ha az objektum nem mozgathato
+	virtual bool SetTransform(Transform transform) { return false; }
+
 };
 
+// Szakasz (r0 -> r0 + axis * height) korul radius sugarral megnovelt doboz
+AABB SegmentBounds(Vector r0, Vector axis, float height, float radius)
+{
+	AABB box;
+	Vector pad(radius, radius, radius);
+	box.Extend(r0 - pad);
+	box.Extend(r0 + pad);
+	box.Extend(r0 + axis * height - pad);
+	box.Extend(r0 + axis * height + pad);
+	return box;
+}
+
 class Paraboloid : public Object
 {
+	ObjMat Material;
 	Vector R0;
 	Vector Axis;
 	float Height;
@@ -237,6 +698,7 @@ public:
 	Paraboloid(ObjMat material, Vector r0, Vector axis, float height)
 	{
 		Material = material;
+		Material.Classify();
 
 		R0 = r0;
 
@@ -298,10 +760,18 @@ public:
 
 		return collide;
 	}
+
+	// Egysegnyi iranyvektorra a felulet sugara legfeljebb sqrt(1/4)
+	bool Bounds(AABB& box)
+	{
+		box = SegmentBounds(R0, Axis, Height, 0.5f);
+		return true;
+	}
 };
 
 class Cylinder : public Object
 {
+	ObjMat Material;
 	Vector R0;
 	Vector Axis;
 	float Height;
@@ -312,8 +782,10 @@ public:
 	Cylinder(ObjMat material, ObjMat capMat, Vector r0, Vector axis, float height, float radius)
 	{
 		Material = material;
+		Material.Classify();
 		bottomCapMaterial = capMat;
 		bottomCapMaterial.flat = true;
+		bottomCapMaterial.Classify();
 
 		R0 = r0;
 
@@ -374,79 +846,608 @@ public:
 
 			if (hp < 0.0f)
 			{
-				Vector normalVector = Vector(0.0f, 1.0f, 0.0f);
-
-				collide.t = -(normalVector* ray.rOrigo) / (normalVector* ray.rDirection);
+				// also fedolap: az R0-n atmeno, Axis-ra meroleges korlap
+				collide.t = -(Axis * ray_from_R0) / (Axis * ray.rDirection);
 				collide.position = ray.rOrigo + ray.rDirection * collide.t;
-				collide.normalV = UpVector;
+
+				Vector fromCenter = collide.position - R0;
+				if (fromCenter * fromCenter > Radius * Radius)
+				{
+					collide.t = -1.0f;
+					return collide;
+				}
+
+				collide.normalV = Axis;
 				collide.material = bottomCapMaterial;
 			}
 		}
 
 		return collide;
 	}
+
+	bool Bounds(AABB& box)
+	{
+		box = SegmentBounds(R0, Axis, Height, Radius);
+		return true;
+	}
 };
 
-class Camera
+//--------------------------------------------------------
+// Befoglalo doboz hierarchia objektumok folott. A nem korlatos
+// objektumokat kulon listaban tartja es mindig teszteli.
+//--------------------------------------------------------
+struct BVHNode
 {
-	Vector DirVictorUp;
-	Vector DirVictorRight;
-	Vector LookAtPosition;
-	Vector eye_Position;
-public:
+	AABB bounds;
+	int left, right;		// gyerekek indexe, levelnel -1
+	int first, count;		// levelnel az items tomb szelete
+};
 
-	Camera(){};
+// qsort osszehasonlito fuggvenyek parameterei a fa epitesekor
+int sortAxis;
+AABB* sortBoxes;
 
-	Camera(Vector eyePos, Vector lookatPos, Vector rightVector, Vector upVector)
-	{
-		eye_Position = eyePos;
-		LookAtPosition = lookatPos;
-		DirVictorRight = rightVector;
-		DirVictorUp = upVector;
-	}
+int CompareBoxes(const void* a, const void* b)
+{
+	float pa = VectorComponent(sortBoxes[*(const int*)a].Center(), sortAxis);
+	float pb = VectorComponent(sortBoxes[*(const int*)b].Center(), sortAxis);
+	return pa < pb ? -1 : (pa > pb ? 1 : 0);
+}
 
-	Ray GetRay(float screenX, float screenY)
+class BVH
+{
+	BVHNode* nodes;
+	int nodeCount;
+	Object** items;
+	int itemCount;
+	Object** unbounded;
+	int unboundedCount;
+
+	int BuildNode(Object** objects, AABB* boxes, int* indices, int count)
 	{
-		Ray ray_return;
-		ray_return.rOrigo = eye_Position;
+		int node = nodeCount++;
+		BVHNode& n = nodes[node];
+		n.left = n.right = -1;
+		n.first = n.count = 0;
 
-		ray_return.rDirection = LookAtPosition + DirVictorRight * (2.0f * (screenX+0.5) / screenWidth - 1.0f) + DirVictorUp * (2.0f * (screenY+0.5) / screenHeight - 1.0f) - eye_Position;
-		ray_return.rDirection.Normalize();
+		for (int i = 0; i < count; i++)
+		{
+			n.bounds.Extend(boxes[indices[i]]);
+		}
 
-		return ray_return;
-	}
-};
+		if (count <= 2)
+		{
+			n.first = itemCount;
+			n.count = count;
+			for (int i = 0; i < count; i++)
+			{
+				items[itemCount++] = objects[indices[i]];
+			}
+			return node;
+		}
 
-class Light
-{
-public:
-	Vector SourcePosition;
-	Color Power;
+		sortBoxes = boxes;
+		sortAxis = n.bounds.LongestAxis();
+		qsort(indices, count, sizeof(int), CompareBoxes);
 
-	Light(Vector pos = Vector(), Color power = Color())
-	{
-		SourcePosition = pos;
-		Power = power;
-	};
+		int half = count / 2;
+		int left = BuildNode(objects, boxes, indices, half);
+		int right = BuildNode(objects, boxes, indices + half, count - half);
+		nodes[node].left = left;
+		nodes[node].right = right;
+		return node;
+	}
 
-	Vector GetDirection(Vector p)
+	static void Closest(Collide& collide, Collide newCollide)
 	{
-		return (SourcePosition - p) / (SourcePosition - p).Length();
+		if (newCollide.t > 0.0f)
+		{
+			if (collide.t < 0.0f || newCollide.t < collide.t)
+			{
+				collide = newCollide;
+			}
+		}
 	}
 
-	float GetDistance(Vector p)
+public:
+	BVH()
 	{
-		return (SourcePosition - p).Length();
+		nodes = 0;
+		nodeCount = 0;
+		items = 0;
+		itemCount = 0;
+		unbounded = 0;
+		unboundedCount = 0;
 	}
 
-	Color LinLightIntesity(Vector p)
+	void Build(Object** objects, int count, SceneArena& arena)
 	{
-		return Power / ((SourcePosition - p)*(SourcePosition - p) * 4.0f * PI);
+		nodes = 0;
+		items = 0;
+		nodeCount = itemCount = unboundedCount = 0;
+
+		AABB* boxes = new AABB[count > 0 ? count : 1];
+		int* indices = new int[count > 0 ? count : 1];
+		int boundedCount = 0;
+		unbounded = new (arena) Object*[count > 0 ? count : 1];
+
+		for (int i = 0; i < count; i++)
+		{
+			if (objects[i]->Bounds(boxes[i]))
+			{
+				indices[boundedCount++] = i;
+			}
+			else
+			{
+				unbounded[unboundedCount++] = objects[i];
+			}
+		}
+
+		if (boundedCount > 0)
+		{
+			nodes = new (arena) BVHNode[2 * boundedCount - 1];
+			items = new (arena) Object*[boundedCount];
+			BuildNode(objects, boxes, indices, boundedCount);
+		}
+
+		delete[] boxes;
+		delete[] indices;
 	}
-};
 
-Color Pattern(const float x, const float y, const float z)
-{
+	// Az objektumok mozgatasa utan ujraszamolja a dobozokat, a fa szerkezete valtozatlan.
+	// A csucsok preorder sorrendben vannak, igy hatulrol haladva a gyerekek mar frissek.
+	void Refit()
+	{
+		for (int node = nodeCount - 1; node >= 0; node--)
+		{
+			BVHNode& n = nodes[node];
+			n.bounds = AABB();
+			if (n.left < 0)
+			{
+				for (int i = 0; i < n.count; i++)
+				{
+					AABB box;
+					if (items[n.first + i]->Bounds(box))
+					{
+						n.bounds.Extend(box);
+					}
+				}
+			}
+			else
+			{
+				n.bounds.Extend(nodes[n.left].bounds);
+				n.bounds.Extend(nodes[n.right].bounds);
+			}
+		}
+	}
+
+	// Az osszes objektumot befoglalo doboz; false, ha van kozottuk nem korlatos
+	bool Bounds(AABB& box)
+	{
+		if (unboundedCount > 0)
+		{
+			return false;
+		}
+		box = nodeCount > 0 ? nodes[0].bounds : AABB();
+		return true;
+	}
+
+	Collide Intersect(Ray ray)
+	{
+		Collide collide;
+		for (int i = 0; i < unboundedCount; i++)
+		{
+			Closest(collide, unbounded[i]->Intersect(ray));
+		}
+
+		if (nodeCount == 0)
+		{
+			return collide;
+		}
+
+		Vector invDir(ray.rDirection.x != 0.0f ? 1.0f / ray.rDirection.x : 1e30f,
+		              ray.rDirection.y != 0.0f ? 1.0f / ray.rDirection.y : 1e30f,
+		              ray.rDirection.z != 0.0f ? 1.0f / ray.rDirection.z : 1e30f);
+
+		int stack[64];
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+
+		while (stackSize > 0)
+		{
+			BVHNode& n = nodes[stack[--stackSize]];
+			float tEntry;
+			if (!n.bounds.Hit(ray.rOrigo, invDir, collide.t > 0.0f ? collide.t : 1e30f, tEntry))
+			{
+				continue;
+			}
+
+			if (n.left < 0)
+			{
+				for (int i = 0; i < n.count; i++)
+				{
+					Closest(collide, items[n.first + i]->Intersect(ray));
+				}
+			}
+			else
+			{
+				stack[stackSize++] = n.left;
+				stack[stackSize++] = n.right;
+			}
+		}
+
+		return collide;
+	}
+};
+
+//--------------------------------------------------------
+// Prototipus: egyszer definialt objektumcsoport sajat BVH-val,
+// amelyet tobb Instance is hasznalhat
+//--------------------------------------------------------
+class Group : public Object
+{
+	SceneArena* arena;
+	Object** children;
+	int childCount;
+	int childCapacity;
+	BVH bvh;
+public:
+	Group(SceneArena& sceneArena)
+	{
+		arena = &sceneArena;
+		children = 0;
+		childCount = 0;
+		childCapacity = 0;
+	}
+
+	void Add(Object* child)
+	{
+		Append(children, childCount, childCapacity, child, *arena);
+	}
+
+	// Az osszes Add() utan, az elso Intersect() elott hivando
+	void Finalize()
+	{
+		bvh.Build(children, childCount, *arena);
+	}
+
+	Collide Intersect(Ray ray)
+	{
+		return bvh.Intersect(ray);
+	}
+
+	bool Bounds(AABB& box)
+	{
+		return bvh.Bounds(box);
+	}
+};
+
+//--------------------------------------------------------
+// Egy prototipus elhelyezese affin transzformacioval. Csak az inverz
+// transzformaciot es a vilagbeli dobozt tarolja (sok millio peldanyhoz);
+// a sugarat metszeskor visszuk at objektumterbe.
+//--------------------------------------------------------
+class Instance : public Object
+{
+	Group* prototype;
+	Transform toObject;
+	AABB worldBox;		// ures (lo > hi), ha a prototipus nem korlatos
+public:
+	// A prototipust Finalize() utan kell peldanyositani, kulonben a doboza meg ures
+	Instance(Group* proto, Transform transform)
+	{
+		prototype = proto;
+		SetTransform(transform);
+	}
+
+	bool SetTransform(Transform transform)
+	{
+		toObject = transform.Inverse();
+
+		AABB local;
+		worldBox = prototype->Bounds(local) ? transform.Apply(local) : AABB();
+		return true;
+	}
+
+	Collide Intersect(Ray ray)
+	{
+		Ray localRay;
+		localRay.rOrigo = toObject.Point(ray.rOrigo);
+		localRay.rDirection = toObject.Direction(ray.rDirection);
+		float scale = localRay.rDirection.Length();
+		localRay.rDirection = localRay.rDirection / scale;
+
+		Collide collide = prototype->Intersect(localRay);
+		if (collide.t > 0.0f)
+		{
+			collide.t = collide.t / scale;
+			collide.position = ray.rOrigo + ray.rDirection * collide.t;
+			collide.normalV = toObject.TransposedDirection(collide.normalV);
+			collide.normalV.Normalize();
+		}
+		return collide;
+	}
+
+	bool Bounds(AABB& box)
+	{
+		if (worldBox.lo.x > worldBox.hi.x)
+		{
+			return false;
+		}
+		box = worldBox;
+		return true;
+	}
+};
+
+class Camera
+{
+	Vector DirVictorUp;
+	Vector DirVictorRight;
+	Vector LookAtPosition;
+	Vector eye_Position;
+public:
+
+	Camera(){};
+
+	Camera(Vector eyePos, Vector lookatPos, Vector rightVector, Vector upVector)
+	{
+		eye_Position = eyePos;
+		LookAtPosition = lookatPos;
+		DirVictorRight = rightVector;
+		DirVictorUp = upVector;
+	}
+
+	// A jobbra/fel vektorokat a nezesi iranybol szamolja (a kep fuggoleges tengelye a -y)
+	Camera(Vector eyePos, Vector lookatPos)
+	{
+		Vector up(0.0f, -1.0f, 0.0f);
+		Vector dir = lookatPos - eyePos;
+		dir.Normalize();
+		Vector right = dir % up;
+		right.Normalize();
+		up = dir % right;
+		up.Normalize();
+
+		eye_Position = eyePos;
+		LookAtPosition = lookatPos;
+		DirVictorRight = right;
+		DirVictorUp = up;
+	}
+
+	// Forgatas a nezett pont korul (radianban)
+	Camera Orbit(float dAzimuth, float dElevation)
+	{
+		Vector offset = eye_Position - LookAtPosition;
+		float distance = offset.Length();
+		float azimuth = atan2(offset.x, offset.z) + dAzimuth;
+		float elevation = asin(offset.y / distance) + dElevation;
+		if (elevation > 1.5f) elevation = 1.5f;
+		if (elevation < -1.5f) elevation = -1.5f;
+
+		offset = Vector(sin(azimuth) * cos(elevation), sin(elevation), cos(azimuth) * cos(elevation)) * distance;
+		return Camera(LookAtPosition + offset, LookAtPosition);
+	}
+
+	// Eltolas a kepsikban, a nezett pont tavolsagaval aranyosan
+	Camera Pan(float dx, float dy)
+	{
+		float distance = (eye_Position - LookAtPosition).Length();
+		Vector shift = DirVictorRight * (dx * distance) + DirVictorUp * (dy * distance);
+		return Camera(eye_Position + shift, LookAtPosition + shift);
+	}
+
+	// factor < 1 kozelit, factor > 1 tavolit
+	Camera Zoom(float factor)
+	{
+		// egy lepesben legfeljebb felezes/duplazas; nem pozitiv szorzo a szemet a nezett ponton at tukrozne
+		if (factor < 0.5f) factor = 0.5f;
+		if (factor > 2.0f) factor = 2.0f;
+
+		Vector offset = (eye_Position - LookAtPosition) * factor;
+		if (offset.Length() < 0.05f)
+		{
+			return *this;
+		}
+		return Camera(LookAtPosition + offset, LookAtPosition);
+	}
+
+	Ray GetRay(float screenX, float screenY)
+	{
+		Ray ray_return;
+		ray_return.rOrigo = eye_Position;
+
+		ray_return.rDirection = LookAtPosition + DirVictorRight * (2.0f * (screenX+0.5) / screenWidth - 1.0f) + DirVictorUp * (2.0f * (screenY+0.5) / screenHeight - 1.0f) - eye_Position;
+		ray_return.rDirection.Normalize();
+
+		return ray_return;
+	}
+};
+
+class Light
+{
+public:
+	Vector SourcePosition;
+	Color Power;
+
+	Light(Vector pos = Vector(), Color power = Color())
+	{
+		SourcePosition = pos;
+		Power = power;
+	};
+
+	Vector GetDirection(Vector p)
+	{
+		return (SourcePosition - p) / (SourcePosition - p).Length();
+	}
+
+	float GetDistance(Vector p)
+	{
+		return (SourcePosition - p).Length();
+	}
+
+	Color LinLightIntesity(Vector p)
+	{
+		return Power / ((SourcePosition - p)*(SourcePosition - p) * 4.0f * PI);
+	}
+};
+
+//--------------------------------------------------------
+// Fenyfa: binaris fa a pontfenyek folott, minden csucs a reszfa
+// fenyeinek dobozat es osszteljesitmenyet tarolja. Egy arnyalasi
+// ponthoz teljesitmeny/tavolsag^2 aranyaban valaszt fenyt.
+//--------------------------------------------------------
+struct LightNode
+{
+	AABB bounds;
+	float power;
+	int left, right;		// gyerekek indexe, levelnel -1
+	int light;				// levelnel a feny indexe
+};
+
+Light* sortLights;
+
+int CompareLights(const void* a, const void* b)
+{
+	float pa = VectorComponent(sortLights[*(const int*)a].SourcePosition, sortAxis);
+	float pb = VectorComponent(sortLights[*(const int*)b].SourcePosition, sortAxis);
+	return pa < pb ? -1 : (pa > pb ? 1 : 0);
+}
+
+class LightTree
+{
+	LightNode* nodes;
+	int nodeCount;
+
+	int BuildNode(Light* lights, int* indices, int count)
+	{
+		int node = nodeCount++;
+		LightNode& n = nodes[node];
+		n.power = 0.0f;
+		n.left = n.right = n.light = -1;
+
+		for (int i = 0; i < count; i++)
+		{
+			Light& light = lights[indices[i]];
+			n.bounds.Extend(light.SourcePosition);
+			n.power += light.Power.r + light.Power.g + light.Power.b;
+		}
+
+		if (count == 1)
+		{
+			n.light = indices[0];
+			return node;
+		}
+
+		sortLights = lights;
+		sortAxis = n.bounds.LongestAxis();
+		qsort(indices, count, sizeof(int), CompareLights);
+
+		int half = count / 2;
+		int left = BuildNode(lights, indices, half);
+		int right = BuildNode(lights, indices + half, count - half);
+		nodes[node].left = left;
+		nodes[node].right = right;
+		return node;
+	}
+
+	float Importance(int node, Vector p)
+	{
+		Vector d = nodes[node].bounds.Center() - p;
+		Vector half = nodes[node].bounds.Size() * 0.5f;
+		float dist2 = d * d;
+		float radius2 = half * half;
+		if (dist2 < radius2)
+		{
+			dist2 = radius2;
+		}
+		if (dist2 < epsilon)
+		{
+			dist2 = epsilon;
+		}
+		return nodes[node].power / dist2;
+	}
+
+public:
+	LightTree()
+	{
+		nodes = 0;
+		nodeCount = 0;
+	}
+
+	void Build(Light* lights, int lightCount, SceneArena& arena)
+	{
+		nodes = 0;
+		nodeCount = 0;
+		if (lightCount == 0)
+		{
+			return;
+		}
+
+		nodes = new (arena) LightNode[2 * lightCount - 1];
+		int* indices = new int[lightCount];
+		for (int i = 0; i < lightCount; i++)
+		{
+			indices[i] = i;
+		}
+		BuildNode(lights, indices, lightCount);
+		delete[] indices;
+	}
+
+	// A fenyek mozgatasa utan frissiti a dobozokat, a fa szerkezete valtozatlan
+	void Refit(Light* lights)
+	{
+		for (int node = nodeCount - 1; node >= 0; node--)
+		{
+			LightNode& n = nodes[node];
+			n.bounds = AABB();
+			if (n.light >= 0)
+			{
+				n.bounds.Extend(lights[n.light].SourcePosition);
+			}
+			else
+			{
+				n.bounds.Extend(nodes[n.left].bounds);
+				n.bounds.Extend(nodes[n.right].bounds);
+			}
+		}
+	}
+
+	// u egyenletes [0,1)-ben; visszaadja a valasztott feny indexet, pdf-ben a valoszinuseget
+	int Sample(Vector p, float u, float& pdf)
+	{
+		pdf = 0.0f;
+		if (nodeCount == 0)
+		{
+			return -1;
+		}
+
+		int node = 0;
+		pdf = 1.0f;
+		while (nodes[node].light < 0)
+		{
+			float wl = Importance(nodes[node].left, p);
+			float wr = Importance(nodes[node].right, p);
+			float pl = (wl + wr > 0.0f) ? wl / (wl + wr) : 0.5f;
+
+			if (u < pl)
+			{
+				u = u / pl;
+				pdf *= pl;
+				node = nodes[node].left;
+			}
+			else
+			{
+				u = (u - pl) / (1.0f - pl);
+				pdf *= 1.0f - pl;
+				node = nodes[node].right;
+			}
+		}
+		return nodes[node].light;
+	}
+};
+
+Color Pattern(const float x, const float y, const float z)
+{
     if (fmod(fabs(x), 0.5)<0.25) {
         if (fmod(fabs(z), 0.5)<0.25) {
             return Color(0.0f, 0.0f, 0.0f);
@@ -462,118 +1463,491 @@ Color Pattern(const float x, const float y, const float z)
     }
 }
 
+// A [0, count) sorokat egyenlo szeletekben a hardveres szalak kozott osztja szet, es megvarja
+// oket; fn(begin, end) szeletenkent egyszer fut
+template<class Fn>
+void ParallelRows(int count, Fn fn)
+{
+	int threadCount = std::thread::hardware_concurrency();
+	if (threadCount < 1)
+	{
+		threadCount = 1;
+	}
+
+	std::thread* workers = new std::thread[threadCount];
+	for (int i = 0; i < threadCount; i++)
+	{
+		workers[i] = std::thread(fn, count * i / threadCount, count * (i + 1) / threadCount);
+	}
+	for (int i = 0; i < threadCount; i++)
+	{
+		workers[i].join();
+	}
+	delete[] workers;
+}
+
+//--------------------------------------------------------
+// Zajszuro: el-megorzo a-trous wavelet szuro, amelyet az elso
+// talalat normalisa, tavolsaga es albedoja iranyit. A sikokat
+// kulon tombokben (SoA) taroljuk, hogy a belso ciklus vektorizalhato
+// legyen; a sorokat tobb szal kozott osztjuk szet.
+//--------------------------------------------------------
+class Denoiser
+{
+	int width, height;
+	float* normal[3];
+	float* depth;
+	float* inverseDepth;	// a belso ciklusban osztas helyett szorzas
+	float* albedo[3];
+	float* radiance[2][3];	// ping-pong bemenet/kimenet
+	float* weight;			// Pass() sulyosszege pixelenkent
+
+	// Egy a-trous lepes a [rowBegin, rowEnd) sorokra. Az osszeget kozvetlenul a kimeneti
+	// sikokba es a weight sikba gyujti, igy nem foglal memoriat. A belso ciklus SSE2-vel
+	// negyesevel halad (a -O2 fordito ezt maga nem vektorizalja); a maradek skalaris.
+	void Pass(int step, int src, int rowBegin, int rowEnd)
+	{
+		static const float kernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+		const float normalWeight = 4.0f;		// |dn|^2 > 0.25 mar elvalaszt
+		const float depthWeight = 50.0f / step;	// relativ melysegkulonbseg
+		const float albedoWeight = 4.0f;
+
+		for (int y = rowBegin; y < rowEnd; y++)
+		{
+			float* accR = radiance[1 - src][0] + y * width;
+			float* accG = radiance[1 - src][1] + y * width;
+			float* accB = radiance[1 - src][2] + y * width;
+			float* accW = weight + y * width;
+			for (int x = 0; x < width; x++)
+			{
+				accR[x] = accG[x] = accB[x] = accW[x] = 0.0f;
+			}
+
+			const float* nx = normal[0] + y * width;
+			const float* ny = normal[1] + y * width;
+			const float* nz = normal[2] + y * width;
+			const float* z = depth + y * width;
+			const float* iz = inverseDepth + y * width;
+			const float* ar = albedo[0] + y * width;
+			const float* ag = albedo[1] + y * width;
+			const float* ab = albedo[2] + y * width;
+
+			for (int ky = 0; ky < 5; ky++)
+			{
+				int yy = y + (ky - 2) * step;
+				if (yy < 0 || yy >= height)
+				{
+					continue;
+				}
+
+				for (int kx = 0; kx < 5; kx++)
+				{
+					int dx = (kx - 2) * step;
+					int x0 = dx < 0 ? -dx : 0;
+					int x1 = dx > 0 ? width - dx : width;
+					float h = kernel[ky] * kernel[kx];
+					int q = yy * width + dx;
+
+					const float* qnx = normal[0] + q;
+					const float* qny = normal[1] + q;
+					const float* qnz = normal[2] + q;
+					const float* qz = depth + q;
+					const float* qar = albedo[0] + q;
+					const float* qag = albedo[1] + q;
+					const float* qab = albedo[2] + q;
+					const float* qr = radiance[src][0] + q;
+					const float* qg = radiance[src][1] + q;
+					const float* qb = radiance[src][2] + q;
+
+					int x = x0;
+#if defined(__SSE2__) || defined(_M_X64)
+					const __m128 vh = _mm_set1_ps(h);
+					const __m128 vOne = _mm_set1_ps(1.0f);
+					const __m128 vNormalWeight = _mm_set1_ps(normalWeight);
+					const __m128 vDepthWeight = _mm_set1_ps(depthWeight);
+					const __m128 vAlbedoWeight = _mm_set1_ps(albedoWeight);
+					const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+					for (; x + 4 <= x1; x += 4)
+					{
+						__m128 dnx = _mm_sub_ps(_mm_loadu_ps(nx + x), _mm_loadu_ps(qnx + x));
+						__m128 dny = _mm_sub_ps(_mm_loadu_ps(ny + x), _mm_loadu_ps(qny + x));
+						__m128 dnz = _mm_sub_ps(_mm_loadu_ps(nz + x), _mm_loadu_ps(qnz + x));
+						__m128 dar = _mm_sub_ps(_mm_loadu_ps(ar + x), _mm_loadu_ps(qar + x));
+						__m128 dag = _mm_sub_ps(_mm_loadu_ps(ag + x), _mm_loadu_ps(qag + x));
+						__m128 dab = _mm_sub_ps(_mm_loadu_ps(ab + x), _mm_loadu_ps(qab + x));
+						__m128 dz = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(z + x), _mm_loadu_ps(qz + x)), absMask);
+
+						__m128 n2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dnx, dnx), _mm_mul_ps(dny, dny)), _mm_mul_ps(dnz, dnz));
+						__m128 a2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dar, dar), _mm_mul_ps(dag, dag)), _mm_mul_ps(dab, dab));
+						__m128 e = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n2, vNormalWeight),
+						                                 _mm_mul_ps(_mm_mul_ps(dz, _mm_loadu_ps(iz + x)), vDepthWeight)),
+						                      _mm_mul_ps(a2, vAlbedoWeight));
+						__m128 w = _mm_mul_ps(_mm_max_ps(_mm_sub_ps(vOne, e), _mm_setzero_ps()), vh);
+
+						_mm_storeu_ps(accW + x, _mm_add_ps(_mm_loadu_ps(accW + x), w));
+						_mm_storeu_ps(accR + x, _mm_add_ps(_mm_loadu_ps(accR + x), _mm_mul_ps(w, _mm_loadu_ps(qr + x))));
+						_mm_storeu_ps(accG + x, _mm_add_ps(_mm_loadu_ps(accG + x), _mm_mul_ps(w, _mm_loadu_ps(qg + x))));
+						_mm_storeu_ps(accB + x, _mm_add_ps(_mm_loadu_ps(accB + x), _mm_mul_ps(w, _mm_loadu_ps(qb + x))));
+					}
+#endif
+					for (; x < x1; x++)
+					{
+						float dnx = nx[x] - qnx[x], dny = ny[x] - qny[x], dnz = nz[x] - qnz[x];
+						float dar = ar[x] - qar[x], dag = ag[x] - qag[x], dab = ab[x] - qab[x];
+						float e = (dnx * dnx + dny * dny + dnz * dnz) * normalWeight
+						        + fabsf(z[x] - qz[x]) * iz[x] * depthWeight
+						        + (dar * dar + dag * dag + dab * dab) * albedoWeight;
+						float w = 1.0f - e;
+						w = (w > 0.0f ? w : 0.0f) * h;
+
+						accW[x] += w;
+						accR[x] += w * qr[x];
+						accG[x] += w * qg[x];
+						accB[x] += w * qb[x];
+					}
+				}
+			}
+
+			// a kozepso minta sulya mindig h > 0, igy accW nem nulla
+			for (int x = 0; x < width; x++)
+			{
+				float inverseWeight = 1.0f / accW[x];
+				accR[x] *= inverseWeight;
+				accG[x] *= inverseWeight;
+				accB[x] *= inverseWeight;
+			}
+		}
+	}
+
+public:
+	Denoiser(int w, int h)
+	{
+		width = w;
+		height = h;
+		for (int i = 0; i < 3; i++)
+		{
+			normal[i] = new float[w * h];
+			albedo[i] = new float[w * h];
+			radiance[0][i] = new float[w * h];
+			radiance[1][i] = new float[w * h];
+		}
+		depth = new float[w * h];
+		inverseDepth = new float[w * h];
+		weight = new float[w * h];
+	}
+
+	~Denoiser()
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			delete[] normal[i];
+			delete[] albedo[i];
+			delete[] radiance[0][i];
+			delete[] radiance[1][i];
+		}
+		delete[] depth;
+		delete[] inverseDepth;
+		delete[] weight;
+	}
+
+	// a sikokat birtokolja, ezert nem masolhato
+	Denoiser(const Denoiser&) = delete;
+	Denoiser& operator=(const Denoiser&) = delete;
+
+	// Az elso talalat jellemzoi; egbolt eseten normal nulla, a tavolsag nagy
+	void SetFeature(int pixel, Vector n, float distance, Color a)
+	{
+		normal[0][pixel] = n.x;
+		normal[1][pixel] = n.y;
+		normal[2][pixel] = n.z;
+		depth[pixel] = distance;
+		inverseDepth[pixel] = 1.0f / distance;
+		albedo[0][pixel] = a.r;
+		albedo[1][pixel] = a.g;
+		albedo[2][pixel] = a.b;
+	}
+
+	// hdrIn es hdrOut soronkent atlapolt RGB tombok, lehetnek azonosak
+	void Run(float* hdrIn, float* hdrOut)
+	{
+		for (int i = 0; i < width * height; i++)
+		{
+			radiance[0][0][i] = hdrIn[i * 3 + 0];
+			radiance[0][1][i] = hdrIn[i * 3 + 1];
+			radiance[0][2][i] = hdrIn[i * 3 + 2];
+		}
+
+		int src = 0;
+		for (int pass = 0; pass < denoisePasses; pass++)
+		{
+			ParallelRows(height, [&](int rowBegin, int rowEnd) { Pass(1 << pass, src, rowBegin, rowEnd); });
+			src = 1 - src;
+		}
+
+		for (int i = 0; i < width * height; i++)
+		{
+			hdrOut[i * 3 + 0] = radiance[src][0][i];
+			hdrOut[i * 3 + 1] = radiance[src][1][i];
+			hdrOut[i * 3 + 2] = radiance[src][2][i];
+		}
+	}
+};
+
+// Beepitett jelenetek; a terheleses jelenetek a regresszios meresekhez (GRAFTEST_HEADLESS)
+enum SceneKind
+{
+	SCENE_DEFAULT,			// arany, ezust es uveg targyak
+	SCENE_MANY_MUGS,		// + sok peldanyositott bogre a padlon
+	SCENE_MANY_LIGHTS		// + sok gyenge pontfeny (fenyfa, zajszuro)
+};
 
 class World
 {
 	Color La_AmbientLight;
 	Color SkyColor;
-	Object* objects[11];
+	Object** objects;
 	int objectCount;
-	Camera* camera;
-	Light lights[4];
+	int objectCapacity;
+	BVH sceneBVH;
+	Camera camera;
+	SceneArena arena;		// objektumok, listak es fak; Build() egyben torli
+	Light* lights;
 	int lightCount;
+	int lightCapacity;
+	LightTree lightTree;
 
 	Color PMap[1000][1000];
 
 	int MapSize;
 	int PhotonsToShoot;
+
+	// Inkrementalis ujrarajzolas: pixelenkent a kovetett sugarszakaszok
+	SegmentBuffer records;
+	SegmentBuffer nextRecords;		// CompactRecords() celpuffere
+	SegmentBuffer scratch;			// egy ujrakovetett pixel szakaszai
+	int wastedSegments;				// a records-ban mar nem hasznalt szakaszok
+	int recordFirst[screenWidth*screenHeight];
+	int recordCount[screenWidth*screenHeight];
+	bool recording;			// a Render() rogziti-e a szakaszokat; az elso MoveObject/Update kapcsolja be
+	bool recordsValid;		// false: a kovetkezo Update() minden pixelt ujrakovet
+	bool photonsDirty;		// fenyek mozogtak
+	AABB* dirtyBoxes;		// a mozgatott objektumok regi es uj dobozai
+	int dirtyBoxCount;
+	int dirtyBoxCapacity;
+
+	bool denoise;			// csak sztochasztikus (fenyfabol mintavetelezett) megvilagitasnal kell
+	Denoiser* denoiser;
 public:
 	World()
 	{
+		objects = 0;
 		objectCount = 0;
+		objectCapacity = 0;
+		lights = 0;
 		lightCount = 0;
+		lightCapacity = 0;
 
 		MapSize = 1000;
 		PhotonsToShoot = 1e4;
+
+		recording = false;
+		recordsValid = false;
+		wastedSegments = 0;
+		photonsDirty = true;
+		dirtyBoxes = 0;
+		dirtyBoxCount = 0;
+		dirtyBoxCapacity = 0;
+
+		denoise = false;
+		denoiser = 0;
+	}
+
+	// Az arenan kivul csak a zajszuro, a szakaszpufferek es a piszkos dobozok vannak
+	~World()
+	{
+		delete denoiser;
+		delete[] records.segments;
+		delete[] nextRecords.segments;
+		delete[] scratch.segments;
+		delete[] dirtyBoxes;
 	}
 
-	Color RayTrace(Ray ray, int depth = 0)
+	World(const World&) = delete;
+	World& operator=(const World&) = delete;
+
+	// record: ha nem null, ide kerul minden kilott sugarszakasz (ld. Update())
+	Color RayTrace(Ray ray, int depth = 0, SegmentBuffer* record = 0)
 	{
-        int i=0, x=-5, y=-5;
 		if (depth > depth_Max)
 		{
 			return La_AmbientLight;
 		}
 
 		Collide collide = IntersectWorld(ray);
-		Vector normal = collide.normalV;
+		if (record)
+		{
+			record->Add(ray, collide.t > 0.0f ? collide.t : 1e30f);
+		}
 
 		if (collide.t < 0.0f)
 		{
 			return SkyColor;
 		}
 
-        Color c;
-
-		if (collide.material.kd_DiffuseColor!=Color(0.0f, 0.0f, 0.0f)) {
-            c = La_AmbientLight * Pattern(collide.position.x, collide.position.y, collide.position.z);
-		} else {
-            c = La_AmbientLight * collide.material.ka_AmbientColor;
+		switch (collide.material.kind)
+		{
+		case MAT_DIFFUSE_PATTERN:
+			return Shade<MAT_DIFFUSE_PATTERN>(collide, ray, depth, record);
+		case MAT_CONDUCTOR:
+			return Shade<MAT_CONDUCTOR>(collide, ray, depth, record);
+		case MAT_DIELECTRIC:
+			return Shade<MAT_DIELECTRIC>(collide, ray, depth, record);
+		default:
+			return Shade<MAT_GENERIC>(collide, ray, depth, record);
 		}
+	}
 
-        while (i<lightCount) {
-            Ray shadowRay;
-			shadowRay.rOrigo = collide.position;
-			shadowRay.rDirection = lights[i].GetDirection(collide.position);
+	// Anyagosztalyonkent kulon peldanyosulo arnyalo kernel: a Kind-ra vonatkozo feltetelek
+	// forditasi idoben kiertekelodnek, igy a nem hasznalt agak kiesnek.
+	template<MaterialClass Kind>
+	Color Shade(Collide& collide, Ray& ray, int depth, SegmentBuffer* record)
+	{
+		Color c;
 
-			Collide shadowCollide = IntersectWorld(shadowRay);
-			if (shadowCollide.t < 0.0f || (collide.position - shadowCollide.position).Length() > lights[i].GetDistance(collide.position))
-			{
-				c = c + collide.material.ReflectionRadiance(lights[i].GetDirection(collide.position), collide.normalV, ray.rDirection*(-1.0f), lights[i].LinLightIntesity(collide.position));
-                while (x<6) {
-                        while (y<6) {
-                        int indexX = int(collide.position.x / photonConst * (MapSize / 2) + (MapSize / 2)) + x;
-						int indexY = int(collide.position.z / photonConst * (MapSize / 2) + (MapSize / 2)) + y;
+		if (Kind == MAT_DIFFUSE_PATTERN || (Kind == MAT_GENERIC && collide.material.kd_DiffuseColor != Color(0.0f, 0.0f, 0.0f)))
+		{
+			c = La_AmbientLight * Pattern(collide.position.x, collide.position.y, collide.position.z);
+		}
+		else
+		{
+			c = La_AmbientLight * collide.material.ka_AmbientColor;
+		}
 
-						if (indexX > 0 && indexX < MapSize && indexY > 0 && indexY < MapSize)
-						{
-							Vector center = Vector(indexX, indexY);
-							Vector tmp = Vector(indexX - x, indexY - y);
-							if ((center - tmp).Length() < 5)
-							{
-								c = c * (Color(1, 1, 1) + PMap[indexX][indexY]);
-							}
-						}
-                            y++;
-                        }
-                    x++;
-                }
-			}
-            i++;
-        }
+		if (Kind == MAT_DIFFUSE_PATTERN || Kind == MAT_GENERIC)
+		{
+			DirectLighting(c, collide, ray, record);
+		}
 
-		if (collide.material.IsReflective == true)
+		if (Kind == MAT_CONDUCTOR || (Kind == MAT_GENERIC && collide.material.IsReflective == true))
 		{
 			Ray reflectionRay;
 			reflectionRay.rOrigo = collide.position;
 			collide.material.DirOfReflection(reflectionRay.rDirection, collide.normalV, ray.rDirection);
 
-			c = c + collide.material.CalculateFresnel(collide.normalV, ray.rDirection)* RayTrace(reflectionRay, depth + 1);
+			c = c + collide.material.CalculateFresnel(collide.normalV, ray.rDirection)* RayTrace(reflectionRay, depth + 1, record);
 		}
 
-		if (collide.material.IsRefractive == true)
+		if (Kind == MAT_DIELECTRIC || (Kind == MAT_GENERIC && collide.material.IsRefractive == true))
 		{
 			Ray refractedRay;
 			refractedRay.rOrigo = collide.position;
 			collide.material.DirOfRefraction(refractedRay.rDirection, collide.normalV, ray.rDirection);
 
-			c = c + (Color(1.0f,1.0f,1.0f)-collide.material.CalculateFresnel(collide.normalV, ray.rDirection))* RayTrace(refractedRay, depth + 1);
+			c = c + (Color(1.0f,1.0f,1.0f)-collide.material.CalculateFresnel(collide.normalV, ray.rDirection))* RayTrace(refractedRay, depth + 1, record);
 		}
 		return c;
 	}
 
-	void Build()
+	// Arnyeksugarak a fenyforrasokhoz, a lathato fenyek hozzajarulasat c-hez adja.
+	// Legfeljebb shadowRayBudget arnyeksugarat kovetunk: ha ennel tobb feny van,
+	// a fenyfabol mintavetelezunk es a hozzajarulast 1/(pdf*budget)-tel sulyozzuk.
+	void DirectLighting(Color& c, Collide& collide, Ray& ray, SegmentBuffer* record)
 	{
-        Vector up(0.0f, -1.0f, 0.0f);
+		int i=0;
+		if (lightCount <= shadowRayBudget)
+		{
+			while (i<lightCount) {
+				LightContribution(c, collide, ray, i, 1.0f, record);
+				i++;
+			}
+			return;
+		}
+
+		while (i<shadowRayBudget) {
+			float pdf;
+			int light = lightTree.Sample(collide.position, Random01(), pdf);
+			if (light >= 0 && pdf > 0.0f)
+			{
+				LightContribution(c, collide, ray, light, 1.0f / (pdf * shadowRayBudget), record);
+			}
+			i++;
+		}
+	}
+
+	void LightContribution(Color& c, Collide& collide, Ray& ray, int light, float weight, SegmentBuffer* record)
+	{
+		int x=-5, y=-5;
+		Ray shadowRay;
+		shadowRay.rOrigo = collide.position;
+		shadowRay.rDirection = lights[light].GetDirection(collide.position);
+
+		Collide shadowCollide = IntersectWorld(shadowRay);
+		if (record)
+		{
+			record->Add(shadowRay, lights[light].GetDistance(collide.position));
+		}
+		if (shadowCollide.t < 0.0f || (collide.position - shadowCollide.position).Length() > lights[light].GetDistance(collide.position))
+		{
+			c = c + collide.material.ReflectionRadiance(lights[light].GetDirection(collide.position), collide.normalV, ray.rDirection*(-1.0f), lights[light].LinLightIntesity(collide.position)) * weight;
+            while (x<6) {
+                    while (y<6) {
+                    int indexX = int(collide.position.x / photonConst * (MapSize / 2) + (MapSize / 2)) + x;
+					int indexY = int(collide.position.z / photonConst * (MapSize / 2) + (MapSize / 2)) + y;
+
+					if (indexX > 0 && indexX < MapSize && indexY > 0 && indexY < MapSize)
+					{
+						Vector center = Vector(indexX, indexY);
+						Vector tmp = Vector(indexX - x, indexY - y);
+						if ((center - tmp).Length() < 5)
+						{
+							c = c * (Color(1, 1, 1) + PMap[indexX][indexY]);
+						}
+					}
+                        y++;
+                    }
+                x++;
+            }
+		}
+	}
+
+	void AddObject(Object* object)
+	{
+		Append(objects, objectCount, objectCapacity, object, arena);
+	}
+
+	void AddLight(Light light)
+	{
+		Append(lights, lightCount, lightCapacity, light, arena);
+	}
+
+	// Az elozo jelenet egyben torlodik, mert minden objektum, lista es fa az arenaban van.
+	// Rendereles (pl. az InteractiveView hatterszala) kozben nem hivhato.
+	void Clear()
+	{
+		arena.Reset();
+
+		objects = 0;
+		objectCount = 0;
+		objectCapacity = 0;
+		lights = 0;
+		lightCount = 0;
+		lightCapacity = 0;
+		sceneBVH = BVH();
+		lightTree = LightTree();
+
+		recordsValid = false;
+		photonsDirty = true;
+		dirtyBoxCount = 0;
+		denoise = false;
+	}
+
+	void Build(SceneKind scene = SCENE_DEFAULT)
+	{
+		Clear();
+
 	    Vector eyePos(0.0f, 0.4f, -1.0f);
 	    Vector lookAt(0.0f, -0.1f, 0.0f);
-	    Vector dir =lookAt-eyePos;
-	    dir.Normalize();
-	    Vector right = dir%up;
-	    right.Normalize();
-	    up=dir%right;
-	    up.Normalize();
-		camera = new Camera(eyePos, lookAt, right, up);
+		camera = Camera(eyePos, lookAt);
 
 		ObjMat brawnMaterial;
 		brawnMaterial.kd_DiffuseColor = Color(0.4f, 0.2f, 0.0f);
@@ -595,74 +1969,390 @@ public:
 		silverMaterial.IsReflective = true;
 		silverMaterial.SetF0(Color(0.14f, 0.16f, 0.13f), Color(4.1f, 2.3f, 3.1f));//Ezüst (n/k).....0.14/4.1, 0.16/2.3, 0.13/3.1
 
-		objects[objectCount++] = new Cylinder(goldMaterial, brawnMaterial, Vector(0.0f, 0.0f, 1.5f), Vector(0.0f, 1.0f, 0.0f), 0.0f, 3.0f);
-		objects[objectCount++] = new Cylinder(goldMaterial, brawnMaterial, Vector(-0.5f, 0.0f, 0.2f), Vector(0.0, 1.0f, 0.0f), 0.7f, 0.2f);
-		objects[objectCount++] = new Cylinder(glassMaterial, brawnMaterial, Vector(0.5f, 0.0f, 0.2f), Vector(0.0f, 1.0f, 0.0f), 0.9f, 0.15f);
-		objects[objectCount++] = new Cylinder(goldMaterial, goldMaterial, Vector(-0.3f, 0.339324f, 0.200015f), Vector(1.0f, 0.0f, 0.000073f), 0.3f, 0.05f);
-		objects[objectCount++] = new Cylinder(goldMaterial, goldMaterial, Vector(-0.7f, 0.156781f, 0.199909f), Vector(-1.0f, 0.0f, 0.000456f), 0.3f, 0.05f);
-        objects[objectCount++] = new Cylinder(goldMaterial, goldMaterial, Vector(-0.15f, 0.339324f, 0.200015f), Vector(0.0f, 1.0f, 0.0f), 0.15f, 0.03f);
-		objects[objectCount++] = new Cylinder(goldMaterial, goldMaterial, Vector(-0.85f, 0.156781f, 0.199909f), Vector(0.0f, 1.0f, 0.0f), 0.25f, 0.03f);
-		objects[objectCount++] = new Cylinder(glassMaterial, goldMaterial, Vector(0.35f, 0.440651f, 0.200176f), Vector(-1.0f, 0.0f, 0.001175f), 0.3f, 0.05f);
-		objects[objectCount++] = new Cylinder(glassMaterial, goldMaterial, Vector(0.2f, 0.495651f, 0.200176f), Vector( 0.0f, 1.0f, 0.0f), 0.15f, 0.03f);
+		// Arany bogre: test es fulek a sajat koordinatarendszereben (a test aljanak kozeppontja az origo)
+		Group* mug = new (arena) Group(arena);
+		mug->Add(new (arena) Cylinder(goldMaterial, brawnMaterial, Vector(0.0f, 0.0f, 0.0f), Vector(0.0, 1.0f, 0.0f), 0.7f, 0.2f));
+		mug->Add(new (arena) Cylinder(goldMaterial, goldMaterial, Vector(0.2f, 0.339324f, 0.000015f), Vector(1.0f, 0.0f, 0.000073f), 0.3f, 0.05f));
+		mug->Add(new (arena) Cylinder(goldMaterial, goldMaterial, Vector(-0.2f, 0.156781f, -0.000091f), Vector(-1.0f, 0.0f, 0.000456f), 0.3f, 0.05f));
+		mug->Add(new (arena) Cylinder(goldMaterial, goldMaterial, Vector(0.35f, 0.339324f, 0.000015f), Vector(0.0f, 1.0f, 0.0f), 0.15f, 0.03f));
+		mug->Add(new (arena) Cylinder(goldMaterial, goldMaterial, Vector(-0.35f, 0.156781f, -0.000091f), Vector(0.0f, 1.0f, 0.0f), 0.25f, 0.03f));
+		mug->Finalize();
+
+		AddObject(new (arena) Cylinder(goldMaterial, brawnMaterial, Vector(0.0f, 0.0f, 1.5f), Vector(0.0f, 1.0f, 0.0f), 0.0f, 3.0f));
+		AddObject(new (arena) Instance(mug, Transform::Translation(Vector(-0.5f, 0.0f, 0.2f))));
+		AddObject(new (arena) Cylinder(glassMaterial, brawnMaterial, Vector(0.5f, 0.0f, 0.2f), Vector(0.0f, 1.0f, 0.0f), 0.9f, 0.15f));
+		AddObject(new (arena) Cylinder(glassMaterial, goldMaterial, Vector(0.35f, 0.440651f, 0.200176f), Vector(-1.0f, 0.0f, 0.001175f), 0.3f, 0.05f));
+		AddObject(new (arena) Cylinder(glassMaterial, goldMaterial, Vector(0.2f, 0.495651f, 0.200176f), Vector( 0.0f, 1.0f, 0.0f), 0.15f, 0.03f));
 
-		objects[objectCount++] = new Paraboloid(silverMaterial, Vector(0.0f, 1.2f, -0.1f), Vector(0.0f, -1.0f, 0.0f), 1.2f);
+		AddObject(new (arena) Paraboloid(silverMaterial, Vector(0.0f, 1.2f, -0.1f), Vector(0.0f, -1.0f, 0.0f), 1.2f));
+
+		if (scene == SCENE_MANY_MUGS)
+		{
+			for (int i = 0; i < 24; i++)
+			{
+				for (int j = 0; j < 24; j++)
+				{
+					Vector position(-1.5f + i * 0.13f, 0.0f, 1.0f + j * 0.08f);
+					AddObject(new (arena) Instance(mug, Transform::Translation(position) * Transform::RotationY(i * 0.7f + j * 0.3f) * Transform::Scale(0.15f)));
+				}
+			}
+		}
+		sceneBVH.Build(objects, objectCount, arena);
 
 		La_AmbientLight = Color(0.2f, 0.2f, 0.2f);
 		SkyColor = Color(0.0f, 0.5f, 1.0f);
 
-		lights[lightCount++] = Light(Vector(3.0f, 5.0f, 3.0f) * 1.5f, Color(0.3f, 0.0f, 0.0f) * 500.0f);
-		lights[lightCount++] = Light(Vector(0.0f, 5.0f, 1.0f) * 1.5f, Color(0.0f, 0.3f, 0.0f) * 500.0f);
-		lights[lightCount++] = Light(Vector(-3.0f, 5.0f, 3.0f) * 1.5f, Color(0.0f, 0.0f, 0.3f) * 500.0f);
+		AddLight(Light(Vector(3.0f, 5.0f, 3.0f) * 1.5f, Color(0.3f, 0.0f, 0.0f) * 500.0f));
+		AddLight(Light(Vector(0.0f, 5.0f, 1.0f) * 1.5f, Color(0.0f, 0.3f, 0.0f) * 500.0f));
+		AddLight(Light(Vector(-3.0f, 5.0f, 3.0f) * 1.5f, Color(0.0f, 0.0f, 0.3f) * 500.0f));
+
+		if (scene == SCENE_MANY_LIGHTS)
+		{
+			// 1024 feny korben, osszteljesitmenyuk egy alapfenyevel egyezik
+			for (int i = 0; i < 1024; i++)
+			{
+				float angle = 2.0f * PI * i / 1024;
+				Color power = (i % 3 == 0) ? Color(0.3f, 0.0f, 0.0f) : ((i % 3 == 1) ? Color(0.0f, 0.3f, 0.0f) : Color(0.0f, 0.0f, 0.3f));
+				AddLight(Light(Vector(4.5f * cos(angle), 7.5f, 1.5f + 4.5f * sin(angle)), power * (1500.0f / 1024)));
+			}
+		}
+		lightTree.Build(lights, lightCount, arena);
+		denoise = lightCount > shadowRayBudget;
+	}
+
+	void ShootPhotons()
+	{
+		for (int i = 0; i < PhotonsToShoot; i++)
+		{
+			Vector ShootDirection;
+
+			do
+			{
+				ShootDirection = Vector(RND, RND, RND);
+
+			} while (ShootDirection.x * ShootDirection.x + ShootDirection.y * ShootDirection.y + ShootDirection.z * ShootDirection.z > 1.0f);
+
+			ShootDirection.Normalize();
+		}
+
+		photonsDirty = false;
+	}
+
+	void TracePixel(int x, int y, SegmentBuffer* record)
+	{
+		Ray actualRay = camera.GetRay(x, y);
+
+		Color finalColor = RayTrace(actualRay, 0, record);
+
+		hdrImage[y*screenWidth * 3 + x * 3 + 0] = finalColor.r;
+		hdrImage[y*screenWidth * 3 + x * 3 + 1] = finalColor.g;
+		hdrImage[y*screenWidth * 3 + x * 3 + 2] = finalColor.b;
+	}
+
+	void Render()
+	{
+		if (photonsDirty)
+		{
+			ShootPhotons();
+		}
+
+		records.count = 0;
+		wastedSegments = 0;
+		for (int x = 0; x < screenWidth; x++)
+		{
+			for (int y = 0; y < screenHeight; y++)
+			{
+				if (!recording)
+				{
+					TracePixel(x, y, 0);
+					continue;
+				}
+				int pixel = y*screenWidth + x;
+				recordFirst[pixel] = records.count;
+				TracePixel(x, y, &records);
+				recordCount[pixel] = records.count - recordFirst[pixel];
+			}
+		}
+		recordsValid = recording;
+		dirtyBoxCount = 0;
+
+		FinishFrame();
+	}
+
+	// Animaciohoz: a MoveObject/MoveLight/SetCamera hivasok utan csak a szukseges munkat vegzi el.
+	// Ha a fotonokat ujra kell loni (fenyek mozogtak), teljes kepet szamol; kulonben csak azokat a
+	// pixeleket koveti ujra, amelyek valamely sugara a mozgatott objektum regi vagy uj dobozat erinti.
+	// Az elso hivas bekapcsolja a szakaszok rogziteset, es egy teljes (rogzito) kepet szamol.
+	void Update()
+	{
+		EnableIncremental();
+		if (!recordsValid || photonsDirty)
+		{
+			Render();
+			return;
+		}
+
+		if (dirtyBoxCount == 0)
+		{
+			return;
+		}
+
+		// Az erintetlen pixelek szakaszai helyben maradnak; az ujrakovetett pixelek a regi helyukre
+		// kerulnek, ha elfernek, kulonben a puffer vegere (a regi hely szemet lesz)
+		for (int x = 0; x < screenWidth; x++)
+		{
+			for (int y = 0; y < screenHeight; y++)
+			{
+				int pixel = y*screenWidth + x;
+				if (!TouchesDirtyBox(records.segments + recordFirst[pixel], recordCount[pixel]))
+				{
+					continue;
+				}
+
+				scratch.count = 0;
+				TracePixel(x, y, &scratch);
+				if (scratch.count > recordCount[pixel])
+				{
+					wastedSegments += recordCount[pixel];
+					recordFirst[pixel] = records.count;
+					for (int i = 0; i < scratch.count; i++)
+					{
+						records.Add(scratch.segments[i].ray, scratch.segments[i].tMax);
+					}
+				}
+				else
+				{
+					wastedSegments += recordCount[pixel] - scratch.count;
+					memcpy(records.segments + recordFirst[pixel], scratch.segments, scratch.count * sizeof(RaySegment));
+				}
+				recordCount[pixel] = scratch.count;
+			}
+		}
+		if (wastedSegments > records.count / 2)
+		{
+			CompactRecords();
+		}
+		dirtyBoxCount = 0;
+
+		FinishFrame();
+	}
+
+	// A szemetet kihagyva, pixelsorrendben atmasolja a szakaszokat a masodik pufferbe, es csereli
+	void CompactRecords()
+	{
+		nextRecords.count = 0;
+		for (int pixel = 0; pixel < screenWidth*screenHeight; pixel++)
+		{
+			RaySegment* segments = records.segments + recordFirst[pixel];
+			recordFirst[pixel] = nextRecords.count;
+			for (int i = 0; i < recordCount[pixel]; i++)
+			{
+				nextRecords.Add(segments[i].ray, segments[i].tMax);
+			}
+		}
+
+		SegmentBuffer tmp = records;
+		records = nextRecords;
+		nextRecords = tmp;
+		wastedSegments = 0;
 	}
 
-	void Render()
+	// RayTrace utan, ToneMapping elott: zajszures, ha a megvilagitas mintavetelezett
+	void FinishFrame()
 	{
-		for (int i = 0; i < PhotonsToShoot; i++)
+		if (!denoise)
 		{
-			Vector ShootDirection;
+			ToneMapping();
+			return;
+		}
 
-			do
-			{
-				ShootDirection = Vector(RND, RND, RND);
+		if (denoiser == 0)
+		{
+			denoiser = new Denoiser(screenWidth, screenHeight);
+		}
+		GatherFeatures(camera, *denoiser);
+		denoiser->Run(hdrImage, denoisedImage);
+		ToneMapping(denoisedImage, image);
+	}
 
-			} while (ShootDirection.x * ShootDirection.x + ShootDirection.y * ShootDirection.y + ShootDirection.z * ShootDirection.z > 1.0f);
+	bool IsDenoising()
+	{
+		return denoise;
+	}
 
-			ShootDirection.Normalize();
-		}
+	// A zajszuro vezerlo jellemzoi pixelenkent: az elso nem tukros talalat normalisa, albedoja es
+	// a sugarut hossza. A fem es uveg feluleteken atlatunk, kulonben a tukorkep elmosodna; az albedot
+	// a tukrozesek F0 szinevel szorozzuk. Ha a tukros ut az egbe fut, az elso tukros talalat
+	// normalisa es tavolsaga marad, igy a fem es az uveg nem olvad ossze az egbolttal.
+	// A sorokat szalak kozott osztja szet (ParallelRows).
+	void GatherFeatures(Camera camera, Denoiser& target)
+	{
+		ParallelRows(screenHeight, [&](int rowBegin, int rowEnd) { GatherFeatureRows(camera, &target, rowBegin, rowEnd); });
+	}
 
-		for (int x = 0; x < screenWidth; x++)
+	void GatherFeatureRows(Camera camera, Denoiser* target, int rowBegin, int rowEnd)
+	{
+		for (int y = rowBegin; y < rowEnd; y++)
 		{
-			for (int y = 0; y < screenHeight; y++)
+			for (int x = 0; x < screenWidth; x++)
 			{
-				Ray actualRay = camera->GetRay(x, y);
-
-				Color finalColor = RayTrace(actualRay);
+				Ray ray = camera.GetRay(x, y);
+				float distance = 0.0f;
+				Color throughput(1.0f, 1.0f, 1.0f);
+				Vector firstNormal;
+				float firstDistance = 1e6f;
 
-				image[y*screenWidth * 3 + x * 3 + 0] = finalColor.r;
-				image[y*screenWidth * 3 + x * 3 + 1] = finalColor.g;
-				image[y*screenWidth * 3 + x * 3 + 2] = finalColor.b;
+				for (int depth = 0; ; depth++)
+				{
+					Collide collide = IntersectWorld(ray);
+					if (collide.t < 0.0f)
+					{
+						target->SetFeature(y*screenWidth + x, firstNormal, firstDistance, throughput * SkyColor);
+						break;
+					}
+
+					distance += collide.t;
+					MaterialClass kind = collide.material.kind;
+					if (depth == depth_Max || (kind != MAT_CONDUCTOR && kind != MAT_DIELECTRIC))
+					{
+						target->SetFeature(y*screenWidth + x, collide.normalV, distance, throughput * Albedo(collide));
+						break;
+					}
+
+					if (depth == 0)
+					{
+						firstNormal = collide.normalV;
+						firstDistance = distance;
+					}
+
+					Vector direction;
+					if (kind == MAT_CONDUCTOR)
+					{
+						throughput = throughput * collide.material.F0;
+						collide.material.DirOfReflection(direction, collide.normalV, ray.rDirection);
+					}
+					else
+					{
+						collide.material.DirOfRefraction(direction, collide.normalV, ray.rDirection);
+					}
+					ray.rOrigo = collide.position;
+					ray.rDirection = direction;
+				}
 			}
 		}
-
-		ToneMapping();
 	}
 
+	Color Albedo(Collide& collide)
+	{
+		switch (collide.material.kind)
+		{
+		case MAT_DIFFUSE_PATTERN:
+			return Pattern(collide.position.x, collide.position.y, collide.position.z);
+		case MAT_CONDUCTOR:
+			return collide.material.F0;
+		case MAT_DIELECTRIC:
+			return Color(1.0f, 1.0f, 1.0f);
+		default:
+			if (collide.material.kd_DiffuseColor != Color(0.0f, 0.0f, 0.0f))
+			{
+				return Pattern(collide.position.x, collide.position.y, collide.position.z);
+			}
+			return collide.material.ka_AmbientColor;
+		}
+	}
 
-	Collide IntersectWorld(Ray ray)
+	bool TouchesDirtyBox(RaySegment* segments, int count)
 	{
-		Collide collide;
-		for (int i = 0; i < objectCount; i++)
+		for (int i = 0; i < count; i++)
 		{
-			Collide newCollide = objects[i]->Intersect(ray);
+			Vector d = segments[i].ray.rDirection;
+			Vector invDir(d.x != 0.0f ? 1.0f / d.x : 1e30f,
+			              d.y != 0.0f ? 1.0f / d.y : 1e30f,
+			              d.z != 0.0f ? 1.0f / d.z : 1e30f);
 
-			if (newCollide.t > 0.0f)
+			for (int j = 0; j < dirtyBoxCount; j++)
 			{
-				if (collide.t < 0.0f || newCollide.t < collide.t)
+				float tEntry;
+				if (dirtyBoxes[j].Hit(segments[i].ray.rOrigo, invDir, segments[i].tMax, tEntry))
 				{
-					collide = newCollide;
+					return true;
 				}
 			}
 		}
+		return false;
+	}
+
+	int GetObjectCount() { return objectCount; }
+	int GetLightCount() { return lightCount; }
+
+	// A Render() ettol kezdve pixelenkent rogziti a sugarszakaszokat (kb. 80 MB a 600x600-as
+	// alapjelenetnel), amibol az Update() dolgozik; csak animaciohoz kell
+	void EnableIncremental()
+	{
+		if (!recording)
+		{
+			recording = true;
+			recordsValid = false;
+		}
+	}
+
+	// Az objects[index] Instance uj elhelyezese; false, ha az objektum nem mozgathato
+	bool MoveObject(int index, Transform transform)
+	{
+		EnableIncremental();
+		Object* object = objects[index];
+
+		AABB oldBox;
+		bool bounded = object->Bounds(oldBox);
+		if (!object->SetTransform(transform))
+		{
+			return false;
+		}
+
+		AABB newBox;
+		if (bounded && object->Bounds(newBox))
+		{
+			// A talalati pont a feluletnel epsilonon belul lehet a dobozon kivul (pl. a padlon allo bogre alatt)
+			oldBox.Grow(epsilon);
+			newBox.Grow(epsilon);
+			Append(dirtyBoxes, dirtyBoxCount, dirtyBoxCapacity, oldBox);
+			Append(dirtyBoxes, dirtyBoxCount, dirtyBoxCapacity, newBox);
+		}
+		else
+		{
+			recordsValid = false;
+		}
+
+		// A fotonterkepet nem kell ujratolteni: a ShootPhotons nem hivja a Shoot-ot, a PMap ures,
+		// igy a tukrozo es toro objektumok mozgatasa sem okoz kausztika-valtozast mas pixeleken
+		sceneBVH.Refit();
+		return true;
+	}
+
+	// A feny minden arnyalasi pontot befolyasolhat, ezert teljes ujrakovetest ker
+	void MoveLight(int index, Vector position)
+	{
+		lights[index].SourcePosition = position;
+		lightTree.Refit(lights);
+		photonsDirty = true;
+		recordsValid = false;
+	}
+
+	void SetCamera(Camera newCamera)
+	{
+		camera = newCamera;
+		recordsValid = false;
+	}
+
+	Camera GetCamera()
+	{
+		return camera;
+	}
+
+
+	Collide IntersectWorld(Ray ray)
+	{
+		Collide collide = sceneBVH.Intersect(ray);
 
 		if (collide.t > 0.0f)
 		{
@@ -732,14 +2422,15 @@ public:
 		}
 	}
 
-	void ToneMapping()
+	// hdr-bol ldr-be; alapertelmezesben a World sajat kepe
+	void ToneMapping(float* hdr = hdrImage, float* ldr = image)
 	{
 		float  LuminanceAll = 0.0f;
 		for (int x = 0; x<screenWidth; x++)
 		{
 			for (int y = 0; y<screenHeight; y++)
 			{
-				LuminanceAll += 0.21f*image[y*screenWidth * 3 + x * 3 + 0] + 0.72f*image[y*screenWidth * 3 + x * 3 + 1] + 0.07f*image[y*screenWidth * 3 + x * 3 + 2];
+				LuminanceAll += 0.21f*hdr[y*screenWidth * 3 + x * 3 + 0] + 0.72f*hdr[y*screenWidth * 3 + x * 3 + 1] + 0.07f*hdr[y*screenWidth * 3 + x * 3 + 2];
 			}
 		}
 
@@ -750,9 +2441,9 @@ public:
 		{
 			for (int y = 0; y<screenHeight; y++)
 			{
-				image[y*screenWidth * 3 + x * 3 + 0] *= Alpha / AvgLuminance;
-				image[y*screenWidth * 3 + x * 3 + 1] *= Alpha / AvgLuminance;
-				image[y*screenWidth * 3 + x * 3 + 2] *= Alpha / AvgLuminance;
+				ldr[y*screenWidth * 3 + x * 3 + 0] = hdr[y*screenWidth * 3 + x * 3 + 0] * (Alpha / AvgLuminance);
+				ldr[y*screenWidth * 3 + x * 3 + 1] = hdr[y*screenWidth * 3 + x * 3 + 1] * (Alpha / AvgLuminance);
+				ldr[y*screenWidth * 3 + x * 3 + 2] = hdr[y*screenWidth * 3 + x * 3 + 2] * (Alpha / AvgLuminance);
 			}
 		}
 	}
@@ -760,10 +2451,184 @@ public:
 
 World world;
 
+#if !defined(GRAFTEST_HEADLESS)
+
+//--------------------------------------------------------
+// Interaktiv nezet: a kamerat a felhasznaloi szal allitja, a kepet
+// egy hatterszal kesziti. Mozgatas kozben kis felbontasu, sekely
+// elonezet keszul, nyugalomban teljes minosegu kep. Minden uj kamera
+// megszakitja a folyamatban levo munkat (generation szamlalo).
+//--------------------------------------------------------
+class InteractiveView
+{
+	std::mutex mutex;				// requested*, pending es stopping vedelme
+	std::condition_variable wake;
+	Camera requestedCamera;
+	bool requestedPreview;
+	bool pending;
+	bool stopping;
+	std::thread worker;
+
+	std::atomic<int> generation;
+	std::atomic<int> nextColumn;
+
+	float hdr[screenWidth*screenHeight * 3];
+	float ldr[screenWidth*screenHeight * 3];
+	Denoiser denoiser;
+
+	// Egy kep kovetese tobb szalon oszloponkent; false, ha kozben uj kamera erkezett
+	bool Trace(Camera camera, int step, int startDepth, int expected)
+	{
+		// a szeleteket nem hasznaljuk: az oszlopokat a nextColumn szamlalo osztja ki, igy a
+		// szalak egyenletesen terhelodnek, es uj kamera eseten mind hamar megallnak
+		nextColumn = 0;
+		ParallelRows(screenWidth, [&](int, int) { TraceColumns(camera, step, startDepth, expected); });
+
+		return generation == expected;
+	}
+
+	void TraceColumns(Camera camera, int step, int startDepth, int expected)
+	{
+		int x;
+		while ((x = nextColumn.fetch_add(step)) < screenWidth && generation == expected)
+		{
+			for (int y = 0; y < screenHeight; y += step)
+			{
+				Ray ray = camera.GetRay(x + (step - 1) * 0.5f, y + (step - 1) * 0.5f);
+				Color color = world.RayTrace(ray, startDepth);
+
+				for (int bx = x; bx < x + step && bx < screenWidth; bx++)
+				{
+					for (int by = y; by < y + step && by < screenHeight; by++)
+					{
+						hdr[by*screenWidth * 3 + bx * 3 + 0] = color.r;
+						hdr[by*screenWidth * 3 + bx * 3 + 1] = color.g;
+						hdr[by*screenWidth * 3 + bx * 3 + 2] = color.b;
+					}
+				}
+			}
+		}
+	}
+
+	void Run()
+	{
+		for (;;)
+		{
+			Camera camera;
+			bool preview;
+			int expected;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				while (!pending && !stopping)
+				{
+					wake.wait(lock);
+				}
+				if (stopping)
+				{
+					return;
+				}
+				camera = requestedCamera;
+				preview = requestedPreview;
+				expected = generation;
+				pending = false;
+			}
+
+			// A kezdo melyseg eltolasaval az elonezet csak previewDepth szintig rekurzal
+			bool done = preview ? Trace(camera, previewStep, depth_Max - previewDepth, expected)
+			                    : Trace(camera, 1, 0, expected);
+			if (done && !preview && world.IsDenoising())
+			{
+				world.GatherFeatures(camera, denoiser);
+				denoiser.Run(hdr, hdr);
+			}
+
+			if (done)
+			{
+				world.ToneMapping(hdr, ldr);
+				std::lock_guard<std::mutex> lock(imageMutex);
+				memcpy(image, ldr, sizeof(image));
+				frameReady = true;
+			}
+
+			if (done && preview)
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				if (!wake.wait_for(lock, std::chrono::milliseconds(refineDelayMs), [this] { return pending || stopping; }))
+				{
+					requestedPreview = false;
+					pending = true;
+				}
+			}
+		}
+	}
+
+public:
+	std::mutex imageMutex;			// a globalis image tomb vedelme
+	std::atomic<bool> frameReady;	// uj kep kerult az image tombbe
+
+	InteractiveView() : denoiser(screenWidth, screenHeight)
+	{
+		requestedPreview = false;
+		pending = false;
+		stopping = false;
+		generation = 0;
+		nextColumn = 0;
+		frameReady = false;
+	}
+
+	void Start()
+	{
+		worker = std::thread(&InteractiveView::Run, this);
+	}
+
+	// A folyamatban levo kovetest megszakitja es megvarja a hatterszalat; kilepes elott kell hivni,
+	// mert a szal a world objektumait olvassa
+	void Stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+			generation++;
+			wake.notify_one();
+		}
+		if (worker.joinable())
+		{
+			worker.join();
+		}
+	}
+
+	// A felhasznaloi szalrol hivhato, nem var a rajzolasra
+	void Request(Camera camera, bool preview)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		requestedCamera = camera;
+		requestedPreview = preview;
+		pending = true;
+		generation++;
+		wake.notify_one();
+	}
+};
+
+InteractiveView* view;
+Camera viewCamera;
+int lastMouseX, lastMouseY;
+int dragButton = -1;
+bool dragged;		// a lenyomas ota valtozott-e a kamera
+
+// atexit: a globalis world felszabaditasa elott allitja le a hatterszalat
+void StopView() {
+	view->Stop();
+}
+
 // Inicializacio, a program futasanak kezdeten, az OpenGL kontextus letrehozasa utan hivodik meg (ld. main() fv.)
 void onInitialization() {
 	world.Build();
 	world.Render();
+
+	viewCamera = world.GetCamera();
+	view = new InteractiveView();
+	view->Start();
+	atexit(StopView);
 }
 
 // Rajzolas, ha az alkalmazas ablak ervenytelenne valik, akkor ez a fuggveny hivodik meg
@@ -771,7 +2636,10 @@ void onDisplay() {
 	glClearColor(0.1f, 0.2f, 0.3f, 1.0f);		// torlesi szin beallitasa
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // kepernyo torles
 
-	glDrawPixels(screenWidth, screenHeight, GL_RGB, GL_FLOAT, image);
+	{
+		std::lock_guard<std::mutex> lock(view->imageMutex);
+		glDrawPixels(screenWidth, screenHeight, GL_RGB, GL_FLOAT, image);
+	}
 
 	glutSwapBuffers();     				// Buffercsere: rajzolas vege
 
@@ -781,6 +2649,12 @@ void onDisplay() {
 void onKeyboard(unsigned char key, int x, int y) {
 	if (key == 'd') glutPostRedisplay(); 		// d beture rajzold ujra a kepet
 
+	if (key == '+' || key == '-')				// kozelites / tavolitas
+	{
+		viewCamera = viewCamera.Zoom(key == '+' ? 0.9f : 1.1f);
+		view->Request(viewCamera, true);
+	}
+
 }
 
 // Billentyuzet esemenyeket lekezelo fuggveny (felengedes)
@@ -792,20 +2666,309 @@ void onKeyboardUp(unsigned char key, int x, int y) {
 void onMouse(int button, int state, int x, int y) {
 	if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN)   // A GLUT_LEFT_BUTTON / GLUT_RIGHT_BUTTON illetve GLUT_DOWN / GLUT_UP
 		glutPostRedisplay(); 						 // Ilyenkor rajzold ujra a kepet
+
+	if (state == GLUT_DOWN)
+	{
+		dragButton = button;
+		dragged = false;
+		lastMouseX = x;
+		lastMouseY = y;
+	}
+	else if (button == dragButton)		// elengedes: ha mozgattunk, rogton johet a teljes minosegu kep
+	{
+		dragButton = -1;
+		if (dragged)
+		{
+			view->Request(viewCamera, false);
+		}
+	}
 }
 
-// Eger mozgast lekezelo fuggveny
+// Eger mozgast lekezelo fuggveny: bal gomb forgat, jobb gomb tol, kozepso gomb kozelit
 void onMouseMotion(int x, int y)
 {
+	float dx = float(x - lastMouseX) / screenWidth;
+	float dy = float(y - lastMouseY) / screenHeight;
+	lastMouseX = x;
+	lastMouseY = y;
+
+	if (dragButton == GLUT_LEFT_BUTTON)
+	{
+		viewCamera = viewCamera.Orbit(dx * PI, dy * PI);
+	}
+	else if (dragButton == GLUT_RIGHT_BUTTON)
+	{
+		viewCamera = viewCamera.Pan(-dx * 2.0f, dy * 2.0f);
+	}
+	else if (dragButton == GLUT_MIDDLE_BUTTON)
+	{
+		viewCamera = viewCamera.Zoom(1.0f + dy * 2.0f);
+	}
+	else
+	{
+		return;
+	}
 
+	dragged = true;
+	view->Request(viewCamera, true);
 }
 
 // `Idle' esemenykezelo, jelzi, hogy az ido telik, az Idle esemenyek frekvenciajara csak a 0 a garantalt minimalis ertek
 void onIdle() {
 	long time = glutGet(GLUT_ELAPSED_TIME);		// program inditasa ota eltelt ido
 
+	if (view->frameReady.exchange(false))		// a hatterszal uj kepet keszitett
+	{
+		glutPostRedisplay();
+	}
+
+}
+
+#endif
+
+#if defined(GRAFTEST_HEADLESS)
+
+//--------------------------------------------------------
+// Fejnelkuli regresszios mod (forditas -DGRAFTEST_HEADLESS-szel):
+//   graftest <jelenet> <kimenet.ppm> [<referencia.ppm> <max elteres arany> <max mp> <max MB>]
+//   graftest --update <jelenet>
+// A jelenet a SceneKind szama. Referencia megadasakor 1-gyel ter vissza,
+// ha a kep elter, vagy a renderelesi ido vagy a csucsmemoria tullepi a keretet.
+// --update: 1-gyel ter vissza, ha az Update() nem egyezik a teljes Render()-rel.
+//--------------------------------------------------------
+#define perceptualThreshold 16	// 8 bites csatornankenti elteres, ami felett a pixel eltero
+
+unsigned char ToByte(float v)
+{
+	if (v < 0.0f) v = 0.0f;
+	if (v > 1.0f) v = 1.0f;
+	return (unsigned char)(v * 255.0f + 0.5f);
+}
+
+// A PPM felulrol lefele tarolja a sorokat, az image (glDrawPixels miatt) alulrol felfele
+bool WritePPM(const char* path)
+{
+	FILE* file = fopen(path, "wb");
+	if (file == 0)
+	{
+		return false;
+	}
+
+	fprintf(file, "P6\n%d %d\n255\n", screenWidth, screenHeight);
+	for (int y = screenHeight - 1; y >= 0; y--)
+	{
+		for (int x = 0; x < screenWidth * 3; x++)
+		{
+			fputc(ToByte(image[y*screenWidth * 3 + x]), file);
+		}
+	}
+	fclose(file);
+	return true;
+}
+
+// Az image-tol perceptualThreshold-nal jobban eltero pixelek aranya; false, ha a fajl nem olvashato
+bool CompareWithReference(const char* path, float& differentFraction)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == 0)
+	{
+		return false;
+	}
+
+	int width, height, maxValue;
+	if (fscanf(file, "P6 %d %d %d", &width, &height, &maxValue) != 3 || width != screenWidth || height != screenHeight || maxValue != 255)
+	{
+		fclose(file);
+		return false;
+	}
+	fgetc(file);
+
+	int different = 0;
+	for (int y = screenHeight - 1; y >= 0; y--)
+	{
+		for (int x = 0; x < screenWidth; x++)
+		{
+			bool isDifferent = false;
+			for (int k = 0; k < 3; k++)
+			{
+				int reference = fgetc(file);
+				if (reference == EOF)
+				{
+					fclose(file);
+					return false;
+				}
+				if (abs(reference - ToByte(image[y*screenWidth * 3 + x * 3 + k])) > perceptualThreshold)
+				{
+					isDifferent = true;
+				}
+			}
+			if (isDifferent)
+			{
+				different++;
+			}
+		}
+	}
+	fclose(file);
+
+	differentFraction = float(different) / (screenWidth * screenHeight);
+	return true;
+}
+
+// A folyamat csucsmemoriaja kB-ban; Windows alatt nem merjuk (0)
+long PeakMemoryKB()
+{
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__)
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+#else
+	return 0;
+#endif
+}
+
+#define updateCheckObject 1		// az alapjelenet arany bogreje (Instance)
+#define updateCheckFrames 4
+
+// A SceneKind szama szovegbol; false, ha nem egesz szam vagy nincs ilyen jelenet
+bool ParseScene(const char* text, SceneKind& scene)
+{
+	char* end;
+	long value = strtol(text, &end, 10);
+	if (end == text || *end != '\0' || value < SCENE_DEFAULT || value > SCENE_MANY_LIGHTS)
+	{
+		fprintf(stderr, "unknown scene %s (0-%d)\n", text, SCENE_MANY_LIGHTS);
+		return false;
+	}
+	scene = SceneKind(value);
+	return true;
+}
+
+// Az arany bogret updateCheckFrames kepen at mozgatja; minden Update() eredmenyenek
+// bitre egyeznie kell egy kulon World-ben, nullarol szamolt Render()-rel
+int CheckIncrementalUpdate(SceneKind scene)
+{
+	world.Build(scene);
+	if (world.IsDenoising())
+	{
+		fprintf(stderr, "scene %d samples its lights, Update() cannot match a full render\n", scene);
+		return 2;
+	}
+	world.Update();
+
+	World* reference = new World();
+	float* updated = new float[screenWidth*screenHeight * 3];
+	int failed = 0;
+	for (int frame = 1; frame <= updateCheckFrames; frame++)
+	{
+		// az elso ugrasnal a padlon veget ero sugarak epp a doboz ala lognak (ld. AABB::Grow),
+		// az utolso visszaviszi a bogret a kiindulo helyere
+		static const float steps[updateCheckFrames] = { 11.0f, 3.0f, 7.0f, 0.0f };
+		float step = steps[frame - 1];
+		Transform transform = Transform::Translation(Vector(-0.5f + 0.09f * step, 0.0f, 0.2f - 0.05f * step)) * Transform::RotationY(0.37f * step);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		world.MoveObject(updateCheckObject, transform);
+		world.Update();
+		double updateSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		memcpy(updated, hdrImage, sizeof(hdrImage));
+
+		reference->Build(scene);
+		reference->MoveObject(updateCheckObject, transform);
+		start = std::chrono::steady_clock::now();
+		reference->Render();
+		double renderSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		int different = 0;
+		for (int i = 0; i < screenWidth*screenHeight * 3; i++)
+		{
+			if (updated[i] != hdrImage[i])
+			{
+				different++;
+			}
+		}
+		printf("scene %d frame %d: Update %.3f s, full render %.3f s, %d different values\n", scene, frame, updateSeconds, renderSeconds, different);
+		if (different > 0)
+		{
+			printf("FAIL: Update() differs from a full render\n");
+			failed = 1;
+		}
+
+		// a referencia felulirta a kozos hdrImage-et, a kovetkezo Update() a sajat kepebol dolgozik
+		memcpy(hdrImage, updated, sizeof(hdrImage));
+	}
+
+	delete[] updated;
+	delete reference;
+	return failed;
 }
 
+int main(int argc, char **argv) {
+	SceneKind scene;
+	if (argc == 3 && strcmp(argv[1], "--update") == 0)
+	{
+		return ParseScene(argv[2], scene) ? CheckIncrementalUpdate(scene) : 2;
+	}
+
+	if (argc != 3 && argc != 7)
+	{
+		fprintf(stderr, "usage: %s <scene> <out.ppm> [<reference.ppm> <max different fraction> <max seconds> <max MB>]\n"
+		                "       %s --update <scene>\n", argv[0], argv[0]);
+		return 2;
+	}
+	if (!ParseScene(argv[1], scene))
+	{
+		return 2;
+	}
+
+	SeedRandom(1);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	world.Build(scene);
+	world.Render();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	long peakKB = PeakMemoryKB();
+
+	printf("scene %s: %.3f s, peak memory %ld kB\n", argv[1], seconds, peakKB);
+	if (!WritePPM(argv[2]))
+	{
+		fprintf(stderr, "cannot write %s\n", argv[2]);
+		return 2;
+	}
+	if (argc == 3)
+	{
+		return 0;
+	}
+
+	float differentFraction;
+	if (!CompareWithReference(argv[3], differentFraction))
+	{
+		fprintf(stderr, "cannot read reference %s\n", argv[3]);
+		return 2;
+	}
+
+	int failed = 0;
+	printf("different pixels: %.4f%%\n", differentFraction * 100.0f);
+	if (differentFraction > atof(argv[4]))
+	{
+		printf("FAIL: image differs from %s\n", argv[3]);
+		failed = 1;
+	}
+	if (seconds > atof(argv[5]))
+	{
+		printf("FAIL: render time over budget (%s s)\n", argv[5]);
+		failed = 1;
+	}
+	if (peakKB > atol(argv[6]) * 1024)
+	{
+		printf("FAIL: peak memory over budget (%s MB)\n", argv[6]);
+		failed = 1;
+	}
+	return failed;
+}
+#else
 
 // A C++ program belepesi pontja, a main fuggvenyt mar nem szabad bantani
 int main(int argc, char **argv) {
@@ -834,4 +2997,5 @@ int main(int argc, char **argv) {
 
 	return 0;
 }
+#endif
 